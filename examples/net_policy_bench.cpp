@@ -0,0 +1,75 @@
+#include <Arduino.h>
+#include <NetClient.h>
+
+#define WIFI_CRED "quickbrownfox", "lazy@dog"
+#define GSM_APN   "data"
+#define BENCH_HOST "example.com"
+#define BENCH_ITER 1000
+
+/*
+  Compares NetClient against the compile-time variants in net_policy.hpp.
+
+  Cycles: run as is, it prints cycles per call for each client type.
+  Size:   build once per NET_BENCH_VARIANT (0 = NetClient, 1 = NetClientWiFi,
+          2 = NetClientGsm) and compare the flash/RAM figures printed by the
+          build. Variant 1 needs -DNET_LINK_WIFI_ONLY and variant 2
+          -DNET_LINK_GSM_ONLY, otherwise the other transport is still in the
+          image. Add -DNET_NO_SSL when the variant does not use TLS.
+*/
+#ifndef NET_BENCH_VARIANT
+#define NET_BENCH_VARIANT -1 // all of them
+#endif
+
+template <typename C>
+void bench(const char *name) {
+    C client;
+    if (!client.connect(BENCH_HOST, 80)) {
+        Serial.printf("%s: connect failed\n\r", name);
+        return;
+    }
+
+    uint32_t start = ESP.getCycleCount();
+    for (int i = 0; i < BENCH_ITER; ++i) {
+        client.available();
+    }
+    uint32_t cycles_available = (ESP.getCycleCount() - start) / BENCH_ITER;
+
+    start = ESP.getCycleCount();
+    for (int i = 0; i < BENCH_ITER; ++i) {
+        client.connected();
+    }
+    uint32_t cycles_connected = (ESP.getCycleCount() - start) / BENCH_ITER;
+
+    client.stop();
+    Serial.printf("%s: available() %u cycles, connected() %u cycles\n\r",
+                  name, cycles_available, cycles_connected);
+}
+
+void setup() {
+    Serial.begin(115200);
+
+#if NET_BENCH_VARIANT == 2
+    Net.begin(NET_GSM_ONLY, NULL, NULL, GSM_APN);
+#elif NET_BENCH_VARIANT == 1
+    Net.begin(NET_WIFI_ONLY, WIFI_CRED, GSM_APN);
+#else
+    Net.begin(NET_WIFI_FIRST, WIFI_CRED, GSM_APN);
+#endif
+    Net.start();
+
+#if NET_BENCH_VARIANT == -1 || NET_BENCH_VARIANT == 0
+    bench<NetClient>("NetClient");
+#endif
+#if (NET_BENCH_VARIANT == -1 || NET_BENCH_VARIANT == 1) && defined(NET_HAS_WIFI)
+    if (Net.connection == NET_CON_WIFI) bench<NetClientWiFi>("NetClientWiFi");
+#endif
+#if (NET_BENCH_VARIANT == -1 || NET_BENCH_VARIANT == 2) && defined(NET_HAS_GSM)
+    if (Net.connection == NET_CON_GSM)  bench<NetClientGsm>("NetClientGsm");
+#endif
+
+    Net.end();
+}
+
+void loop() {
+    delay(1000);
+}
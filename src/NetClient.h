@@ -1 +1,3 @@
 #include "net.hpp"
+#include "net_policy.hpp"
+#include "ota.hpp"
@@ -31,16 +31,21 @@ TinyGsm global_modem(SerialAT);
             DBG("GSM timeout at " step);        \
             break;                              \
         }                                       \
+        NetTimeline.phase_try(NET_CON_GSM);     \
     }
 
-#define GSM_OK_CHECK(step)                          \
-    {                                               \
-        if (!ok) {                                  \
-            DBG("GSM setup is not ok after " step); \
-            return false;                           \
-        }                                           \
+#define GSM_OK_CHECK(step)                                \
+    {                                                     \
+        NetTimeline.phase_end(NET_CON_GSM, ok);           \
+        if (!ok) {                                        \
+            DBG("GSM setup is not ok after " step);       \
+            NetTimeline.end_attempt(NET_CON_GSM, false);  \
+            return false;                                 \
+        }                                                 \
     }
 
+#define GSM_STEP_FAILED(step) NetTimeline.step_failed(NET_CON_GSM, step)
+
 bool gsm_connect(TinyGsm    *modem,
                  const char *gsm_pin,
                  const char *apn,
@@ -56,8 +61,11 @@ bool gsm_start(TinyGsm    *modem,
     long start;
     int retry_timeout;
 
+    NetTimeline.begin_attempt(NET_CON_GSM);
+
     // setup =================
 
+    NetTimeline.phase_begin(NET_CON_GSM, NET_PHASE_GSM_SETUP);
     start = millis();
     retry_timeout = 20000;
     int attempts_max   = 2;
@@ -93,8 +101,10 @@ bool gsm_start(TinyGsm    *modem,
         DBG("Initializing modem...");
         if (!modem->init()) {
             ok = false;
+            GSM_STEP_FAILED("init");
             if (++setup_attempts > attempts_max) {
                 DBG("Failed to init modem, closing...");
+                NetTimeline.end_attempt(NET_CON_GSM, false);
                 return false;
             } else {
                 DBG("Failed to init modem, retrying...");
@@ -122,6 +132,7 @@ bool gsm_start(TinyGsm    *modem,
 
     // init ==================
 
+    NetTimeline.phase_begin(NET_CON_GSM, NET_PHASE_GSM_INIT);
     start = millis();
     retry_timeout = 20000;
     ok = false;
@@ -133,6 +144,7 @@ bool gsm_start(TinyGsm    *modem,
         DBG("Initializing modem...");
         if (!modem->init()) {
             DBG("Failed to init modem, retrying...");
+            GSM_STEP_FAILED("init");
             ok = false;
             continue;
         }
@@ -154,6 +166,7 @@ bool gsm_start(TinyGsm    *modem,
 
     // net connect ==================
 
+    NetTimeline.phase_begin(NET_CON_GSM, NET_PHASE_GSM_NET_CONNECT);
     start = millis();
     retry_timeout = 20000;
     ok = false;
@@ -163,6 +176,7 @@ bool gsm_start(TinyGsm    *modem,
         DBG("Waiting for network...");
         if (!modem->waitForNetwork(retry_timeout / 2)) {
             DBG("fail");
+            GSM_STEP_FAILED("waitForNetwork");
             delay(1000);
             ok = false;
             continue;
@@ -193,8 +207,14 @@ bool gsm_connect(TinyGsm    *modem,
     long start;
     int retry_timeout;
 
+    // gsm_start() opens the attempt, unless this is a reconnect
+    if (!NetTimeline.in_attempt(NET_CON_GSM)) {
+        NetTimeline.begin_attempt(NET_CON_GSM);
+    }
+
     // connect ==================
 
+    NetTimeline.phase_begin(NET_CON_GSM, NET_PHASE_GSM_GPRS_CONNECT);
     start = millis();
     retry_timeout = 10000;
     ok = false;
@@ -206,6 +226,7 @@ bool gsm_connect(TinyGsm    *modem,
         DBG(apn);
         if (!modem->gprsConnect(apn, gprs_user, gprs_passwd)) {
             DBG(" fail");
+            GSM_STEP_FAILED("gprsConnect");
             delay(1000);
             ok = false;
             continue;
@@ -221,10 +242,17 @@ bool gsm_connect(TinyGsm    *modem,
         ok = true;
     }
     GSM_OK_CHECK("connect");
+    NetTimeline.end_attempt(NET_CON_GSM, true);
 
     bool res = modem->isGprsConnected();
     DBG("GPRS status:", res ? "connected" : "not connected");
 
+    return true;
+}
+
+// Telemetry only; NetClass submits it at MODEM_PRIO_TELEMETRY so it never
+// holds up socket data
+void gsm_print_info(TinyGsm *modem) {
     String ccid = modem->getSimCCID();
     DBG("CCID:", ccid);
 
@@ -242,8 +270,6 @@ bool gsm_connect(TinyGsm    *modem,
 
     int csq = modem->getSignalQuality();
     DBG("Signal quality:", csq);
-
-    return true;
 }
 
 void gsm_end(TinyGsm *modem) {
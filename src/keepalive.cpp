@@ -0,0 +1,184 @@
+#include <Arduino.h>
+
+#include "net.hpp"
+
+NetKeepaliveClass NetKeepalive;
+
+// NAT estimate ==================
+
+unsigned long NetNatEstimate::interval() {
+    unsigned long safe = max(this->alive_max, (unsigned long) NET_KEEPALIVE_MIN);
+    if (this->dead_min == 0) {
+        // no drop seen yet, probe upwards
+        return min(safe * 2, (unsigned long) NET_KEEPALIVE_MAX);
+    }
+    if (this->dead_min > safe + NET_KEEPALIVE_RESOLUTION) {
+        return safe + (this->dead_min - safe) / 2;
+    }
+    return safe;
+}
+
+void NetNatEstimate::alive(unsigned long gap) {
+    if (gap <= this->alive_max) {
+        return;
+    }
+    this->alive_max = gap;
+    if (this->dead_min != 0 && this->dead_min <= gap) {
+        // the timeout grew (or the earlier drop was not the NAT)
+        this->dead_min = 0;
+    }
+    DBG("NetKeepalive: NAT survived", gap);
+}
+
+void NetNatEstimate::dead(unsigned long gap) {
+    if (gap < NET_KEEPALIVE_MIN) {
+        return; // too short to be the NAT
+    }
+    if (gap <= this->alive_max) {
+        // the timeout shrank; learn again from below
+        this->alive_max = gap / 2;
+    }
+    if (this->dead_min == 0 || gap < this->dead_min) {
+        this->dead_min = gap;
+    }
+    DBG("NetKeepalive: NAT dropped after", gap);
+}
+
+// Manager ==================
+
+void NetKeepaliveClass::add(NetClient *client) {
+    client->last_activity = millis();
+    client->pending_gap   = 0;
+
+    portENTER_CRITICAL(&this->lock);
+    int free_slot = -1;
+    for (int i = 0; i < NET_KEEPALIVE_MAX_CLIENTS; ++i) {
+        if (this->clients[i] == client) {
+            free_slot = -2;
+            break;
+        }
+        if (this->clients[i] == NULL && free_slot == -1) {
+            free_slot = i;
+        }
+    }
+    if (free_slot >= 0) {
+        this->clients[free_slot] = client;
+    }
+    portEXIT_CRITICAL(&this->lock);
+
+    if (free_slot == -1) {
+        DBG("NetKeepalive: too many clients, not tracking this one");
+    }
+}
+
+// Called from ~NetClient(), so it waits while loop() is sending on the
+// client from another task; the caller may free it as soon as this returns.
+void NetKeepaliveClass::remove(NetClient *client) {
+    for (;;) {
+        portENTER_CRITICAL(&this->lock);
+        for (int i = 0; i < NET_KEEPALIVE_MAX_CLIENTS; ++i) {
+            if (this->clients[i] == client) {
+                this->clients[i] = NULL;
+            }
+        }
+        bool busy = this->sending == client &&
+            this->sending_task != xTaskGetCurrentTaskHandle();
+        portEXIT_CRITICAL(&this->lock);
+        if (!busy) {
+            return;
+        }
+        delay(1);
+    }
+}
+
+// call with the lock held
+bool NetKeepaliveClass::tracked(NetClient *client) {
+    for (int i = 0; i < NET_KEEPALIVE_MAX_CLIENTS; ++i) {
+        if (this->clients[i] == client) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Every send refreshes the NAT binding, so only the idle gap before the
+// latest one can have let it expire; it is confirmed once something comes
+// back, and blamed if the connection is then found dropped.
+void NetKeepaliveClass::on_send(NetClient *client) {
+    unsigned long now = millis();
+    client->pending_gap   = now - client->last_activity;
+    client->last_activity = now;
+}
+
+void NetKeepaliveClass::on_receive(NetClient *client) {
+    unsigned long now = millis();
+    unsigned long gap = max(client->pending_gap, now - client->last_activity);
+    this->links[client->client_connection].alive(gap);
+    client->pending_gap   = 0;
+    client->last_activity = now;
+}
+
+// Only a drop after an unanswered send says something about the NAT; a
+// peer closing the connection on its own does not.
+void NetKeepaliveClass::on_drop(NetClient *client) {
+    if (client->pending_gap != 0) {
+        this->links[client->client_connection].dead(client->pending_gap);
+    }
+    this->remove(client);
+}
+
+void NetKeepaliveClass::loop() {
+    NetClient *due[NET_KEEPALIVE_MAX_CLIENTS];
+    int        due_count = 0;
+    bool       any_due[3] = { false };
+    unsigned long now = millis();
+
+    portENTER_CRITICAL(&this->lock);
+    for (int i = 0; i < NET_KEEPALIVE_MAX_CLIENTS; ++i) {
+        NetClient *c = this->clients[i];
+        if (c != NULL &&
+            now - c->last_activity >= this->links[c->client_connection].interval()) {
+            any_due[c->client_connection] = true;
+        }
+    }
+    // piggyback the nearly due clients of the same link
+    for (int i = 0; i < NET_KEEPALIVE_MAX_CLIENTS; ++i) {
+        NetClient *c = this->clients[i];
+        if (c == NULL || !any_due[c->client_connection]) {
+            continue;
+        }
+        unsigned long interval = this->links[c->client_connection].interval();
+        if ((now - c->last_activity) * 100 >= interval * NET_KEEPALIVE_MERGE) {
+            due[due_count++] = c;
+        }
+    }
+    portEXIT_CRITICAL(&this->lock);
+
+    for (int i = 0; i < due_count; ++i) {
+        NetClient *c = due[i];
+        // it may have been removed (and freed) since the lock was released
+        portENTER_CRITICAL(&this->lock);
+        bool alive = this->tracked(c);
+        if (alive) {
+            this->sending      = c;
+            this->sending_task = xTaskGetCurrentTaskHandle();
+        }
+        portEXIT_CRITICAL(&this->lock);
+        if (!alive) {
+            continue;
+        }
+
+        OnNetKeepalive send = c->onkeepalive != NULL ? c->onkeepalive : this->onkeepalive;
+        if (send != NULL) {
+            DBG("NetKeepalive: sending keepalive");
+            if (!send(c)) {
+                // already closed; connected() learns from drops it finds
+                this->remove(c);
+            }
+        }
+
+        portENTER_CRITICAL(&this->lock);
+        this->sending = NULL;
+        portEXIT_CRITICAL(&this->lock);
+    }
+}
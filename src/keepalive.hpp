@@ -0,0 +1,62 @@
+#ifndef NET_CLIENT_KEEPALIVE_H_
+#define NET_CLIENT_KEEPALIVE_H_
+
+// Included from net.hpp, after NetConnection is declared
+
+#define NET_KEEPALIVE_MAX_CLIENTS 8
+#define NET_KEEPALIVE_MIN         30000   // ms; never sent more often than this
+#define NET_KEEPALIVE_MAX         1800000 // ms; upper bound while probing
+#define NET_KEEPALIVE_RESOLUTION  15000   // ms; stop probing once this close to the timeout
+#define NET_KEEPALIVE_MERGE       75      // % of the interval; idle clients sent along with a due one
+
+class NetClient;
+
+// Sends a protocol level keepalive (e.g. a WebSocket ping) on `client'
+using OnNetKeepalive = std::function<bool(NetClient *client)>;
+
+/*
+  What is known about the carrier NAT idle timeout of one link. It lies
+  somewhere in (alive_max, dead_min]: alive_max is the longest idle gap
+  after which data was still received, dead_min the shortest gap after
+  which a connection was found dropped (0 while unknown).
+*/
+struct NetNatEstimate {
+    unsigned long alive_max = 0;
+    unsigned long dead_min  = 0;
+
+    unsigned long interval();
+    void          alive(unsigned long gap);
+    void          dead(unsigned long gap);
+};
+
+/*
+  Tracks connected NetClients and sends keepalives on the ones that were
+  idle for as long as their link's NAT is believed to allow. Real traffic
+  counts as a keepalive, and clients close to due are sent together with
+  a due one so the radio wakes up once. Call loop() from the same task
+  that drives the protocol (e.g. next to webSocket.loop()).
+*/
+class NetKeepaliveClass {
+public:
+    NetNatEstimate  links[3];     // indexed by NetConnection
+    OnNetKeepalive  onkeepalive = NULL; // used for clients without their own
+
+    void add(NetClient *client);
+    void remove(NetClient *client);
+    void on_send(NetClient *client);
+    void on_receive(NetClient *client);
+    void on_drop(NetClient *client);
+    void loop();
+
+private:
+    portMUX_TYPE  lock = portMUX_INITIALIZER_UNLOCKED;
+    NetClient    *clients[NET_KEEPALIVE_MAX_CLIENTS] = { NULL };
+    NetClient    *sending      = NULL; // client loop() is sending on, see remove()
+    TaskHandle_t  sending_task = NULL;
+
+    bool          tracked(NetClient *client);
+};
+
+extern NetKeepaliveClass NetKeepalive;
+
+#endif // NET_CLIENT_KEEPALIVE_H_
@@ -0,0 +1,195 @@
+#include <Arduino.h>
+#include <Preferences.h>
+#include <time.h>
+
+#include "net.hpp"
+
+NetMeterClass NetMeter;
+
+static const char *meter_keys[3][2] = {
+    { "none_in", "none_out" },
+    { "wifi_in", "wifi_out" },
+    { "gsm_in",  "gsm_out"  },
+};
+
+void NetMeterClass::begin() {
+    uint64_t    elapsed = 0;
+    Preferences prefs;
+    if (!prefs.begin(NET_METER_NVS_NAMESPACE, true)) {
+        DBG("NetMeter: nothing saved yet");
+    } else {
+        for (int l = 0; l < 3; ++l) {
+            this->links[l].in  = prefs.getULong64(meter_keys[l][0], 0);
+            this->links[l].out = prefs.getULong64(meter_keys[l][1], 0);
+        }
+        this->gsm_period_used = prefs.getULong64("gsm_used", 0);
+        elapsed = prefs.getULong64("gsm_elapsed", 0);
+        // Without a set clock the period resumes where it was last saved;
+        // the wall clock also counts the time spent powered off.
+        uint64_t epoch = prefs.getULong64("gsm_epoch", 0);
+        time_t   now   = time(NULL);
+        if (epoch >= NET_METER_VALID_TIME && (uint64_t) now >= epoch) {
+            elapsed = ((uint64_t) now - epoch) * 1000;
+        }
+        prefs.end();
+    }
+
+    this->last_save_at = millis();
+    if (elapsed >= NET_BUDGET_PERIOD) {
+        this->new_period();
+        return;
+    }
+    // unsigned arithmetic, millis() - period_start gives elapsed back
+    this->period_start = millis() - (unsigned long) elapsed;
+    this->update_state();
+}
+
+void NetMeterClass::set_gsm_budget(uint64_t bytes_per_period) {
+    this->gsm_budget = bytes_per_period;
+    this->update_state();
+}
+
+// Call this from an RTC/NTP based schedule to align periods with days
+void NetMeterClass::new_period() {
+    portENTER_CRITICAL(&this->lock);
+    this->gsm_period_used = 0;
+    this->period_start    = millis();
+    this->dirty           = true;
+    portEXIT_CRITICAL(&this->lock);
+    this->update_state();
+}
+
+void NetMeterClass::count(NetConnection link, size_t in, size_t out) {
+    if (in == 0 && out == 0) {
+        return;
+    }
+
+    portENTER_CRITICAL(&this->lock);
+    this->links[link].in  += in;
+    this->links[link].out += out;
+    if (link == NET_CON_GSM) {
+        this->gsm_period_used += in + out;
+    }
+    this->dirty = true;
+    portEXIT_CRITICAL(&this->lock);
+
+    this->check_period();
+    if (link == NET_CON_GSM) {
+        this->update_state();
+    }
+
+    if (millis() - this->last_save_at >= NET_METER_SAVE_PERIOD) {
+        this->save();
+    }
+}
+
+bool NetMeterClass::deferred(NetConnection link, NetPriority prio) {
+    this->check_period();
+    return link == NET_CON_GSM && prio == NET_PRIO_LOW &&
+        this->budget_state == NET_BUDGET_EXHAUSTED;
+}
+
+// Returns how many of `size' bytes may be sent now; 0 means defer
+size_t NetMeterClass::allow(NetConnection link, NetPriority prio, size_t size) {
+    this->check_period();
+    if (link != NET_CON_GSM || prio != NET_PRIO_LOW ||
+        this->budget_state == NET_BUDGET_OK) {
+        return size;
+    }
+    if (this->budget_state == NET_BUDGET_EXHAUSTED) {
+        return 0;
+    }
+
+    // token bucket, refilled once per second
+    portENTER_CRITICAL(&this->lock);
+    if (millis() - this->throttle_at >= 1000) {
+        this->throttle_at   = millis();
+        this->throttle_left = NET_BUDGET_THROTTLE_BPS;
+    }
+    if (size > this->throttle_left) {
+        size = this->throttle_left;
+    }
+    this->throttle_left -= size;
+    portEXIT_CRITICAL(&this->lock);
+    return size;
+}
+
+void NetMeterClass::save() {
+    if (!this->dirty) {
+        return;
+    }
+
+    NetByteCount links[3];
+    uint64_t     gsm_used;
+    uint64_t     elapsed;
+    portENTER_CRITICAL(&this->lock);
+    for (int l = 0; l < 3; ++l) {
+        links[l] = this->links[l];
+    }
+    gsm_used           = this->gsm_period_used;
+    elapsed            = millis() - this->period_start;
+    this->dirty        = false;
+    this->last_save_at = millis();
+    portEXIT_CRITICAL(&this->lock);
+
+    Preferences prefs;
+    if (!prefs.begin(NET_METER_NVS_NAMESPACE, false)) {
+        DBG("NetMeter: ERROR: failed to open NVS");
+        return;
+    }
+    for (int l = 0; l < 3; ++l) {
+        prefs.putULong64(meter_keys[l][0], links[l].in);
+        prefs.putULong64(meter_keys[l][1], links[l].out);
+    }
+    prefs.putULong64("gsm_used", gsm_used);
+    prefs.putULong64("gsm_elapsed", elapsed);
+    time_t now = time(NULL);
+    prefs.putULong64("gsm_epoch", now >= NET_METER_VALID_TIME ?
+                     (uint64_t) now - elapsed / 1000 : 0);
+    prefs.end();
+}
+
+void NetMeterClass::reset() {
+    portENTER_CRITICAL(&this->lock);
+    for (int l = 0; l < 3; ++l) {
+        this->links[l] = NetByteCount();
+    }
+    this->gsm_period_used = 0;
+    this->period_start    = millis();
+    this->dirty           = true;
+    portEXIT_CRITICAL(&this->lock);
+    this->save();
+    this->update_state();
+}
+
+NetBudgetState NetMeterClass::compute_state() {
+    if (this->gsm_budget == 0) {
+        return NET_BUDGET_OK;
+    }
+    if (this->gsm_period_used >= this->gsm_budget) {
+        return NET_BUDGET_EXHAUSTED;
+    }
+    if (this->gsm_period_used * 100 >= this->gsm_budget * NET_BUDGET_NEAR_PERCENT) {
+        return NET_BUDGET_NEAR;
+    }
+    return NET_BUDGET_OK;
+}
+
+// Periods follow each other even when nothing is counted, so that a budget
+// exhausted by deferred traffic frees up on time.
+void NetMeterClass::check_period() {
+    if (millis() - this->period_start >= NET_BUDGET_PERIOD) {
+        this->new_period();
+    }
+}
+
+void NetMeterClass::update_state() {
+    NetBudgetState prev = this->budget_state;
+    this->budget_state = this->compute_state();
+    if (prev != this->budget_state) {
+        DBG("NetMeter: GSM budget state changed to", this->budget_state);
+        if (this->onbudgetchange != NULL) {
+            this->onbudgetchange(this->budget_state, NET_CON_GSM);
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef NET_CLIENT_METER_H_
+#define NET_CLIENT_METER_H_
+
+// Included from net.hpp, after NetConnection is declared
+
+#define NET_METER_NVS_NAMESPACE  "netmeter"
+#define NET_METER_SAVE_PERIOD    60000      // ms; limits flash wear
+#define NET_BUDGET_PERIOD        86400000UL // ms; one day
+#define NET_BUDGET_NEAR_PERCENT  90         // low priority traffic is throttled above this
+#define NET_BUDGET_THROTTLE_BPS  512        // bytes/s allowed to low priority traffic when near
+#define NET_METER_VALID_TIME     1577836800 // 2020-01-01; an earlier time() means the clock is not set
+
+typedef enum {
+    NET_PRIO_NORMAL,
+    NET_PRIO_LOW    // deferred/throttled when the GSM budget runs low
+} NetPriority;
+
+typedef enum {
+    NET_BUDGET_OK,
+    NET_BUDGET_NEAR,
+    NET_BUDGET_EXHAUSTED
+} NetBudgetState;
+
+struct NetByteCount {
+    uint64_t in  = 0;
+    uint64_t out = 0;
+};
+
+// the budget only applies to NET_CON_GSM for now
+using OnNetBudgetChange = std::function<void(NetBudgetState state, NetConnection link)>;
+
+class NetMeterClass {
+public:
+    NetByteCount   links[3];                    // indexed by NetConnection
+    uint64_t       gsm_budget      = 0;         // bytes per period, 0 means unlimited
+    uint64_t       gsm_period_used = 0;
+    unsigned long  period_start    = 0;
+    NetBudgetState budget_state    = NET_BUDGET_OK;
+
+    OnNetBudgetChange onbudgetchange = NULL;
+
+    void           begin();
+    void           set_gsm_budget(uint64_t bytes_per_period);
+    void           new_period();
+    void           count(NetConnection link, size_t in, size_t out);
+    bool           deferred(NetConnection link, NetPriority prio);
+    size_t         allow(NetConnection link, NetPriority prio, size_t size);
+    void           save();
+    void           reset();
+
+private:
+    portMUX_TYPE   lock           = portMUX_INITIALIZER_UNLOCKED;
+    unsigned long  last_save_at   = 0;
+    unsigned long  throttle_at    = 0;
+    size_t         throttle_left  = 0;
+    bool           dirty          = false;
+
+    NetBudgetState compute_state();
+    void           update_state();
+    void           check_period();
+};
+
+extern NetMeterClass NetMeter;
+
+#endif // NET_CLIENT_METER_H_
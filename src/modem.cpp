@@ -0,0 +1,167 @@
+#include <Arduino.h>
+
+#include "net.hpp"
+
+#ifdef NET_HAS_GSM
+
+ModemClass NetModem;
+
+/*
+  submit() requests live on the heap with their shared result state.
+  call() requests live on the caller's stack instead, and the caller is
+  woken with a task notification, as it waits for the result anyway.
+*/
+struct ModemRequest {
+    ModemJob                          job;
+    OnModemResult                     callback;
+    std::shared_ptr<ModemResultState> state;
+    TaskHandle_t                      waiter = NULL; // set by call()
+    int                               result = 0;
+};
+
+static void modem_run(TinyGsm *modem, ModemRequest *req) {
+    int result = req->job(modem);
+    req->state->result = result;
+    req->state->ready  = true;
+    xSemaphoreGive(req->state->done);
+    if (req->callback != NULL) {
+        req->callback(result);
+    }
+}
+
+bool ModemFuture::ready() {
+    return this->state != NULL && this->state->ready;
+}
+
+int ModemFuture::get(uint32_t timeout_ms) {
+    if (this->state == NULL) {
+        return 0;
+    }
+    if (this->state->ready) {
+        return this->state->result;
+    }
+    TickType_t ticks = timeout_ms == UINT32_MAX ?
+        portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+    if (xSemaphoreTake(this->state->done, ticks) != pdTRUE) {
+        DBG("ModemFuture::get(): timeout");
+        return 0;
+    }
+    // let other waiters on the same future through
+    xSemaphoreGive(this->state->done);
+    return this->state->result;
+}
+
+void ModemClass::begin(TinyGsm *modem) {
+    if (this->task != NULL) {
+        return;
+    }
+    this->modem = modem;
+
+    for (int p = 0; p < MODEM_PRIO_COUNT; ++p) {
+        this->queues[p] = xQueueCreate(MODEM_QUEUE_LENGTH, sizeof(ModemRequest *));
+    }
+    this->pending = xSemaphoreCreateCounting(MODEM_QUEUE_LENGTH * MODEM_PRIO_COUNT, 0);
+
+    xTaskCreatePinnedToCore([](void *arg) {
+        Serial.println("Net: modem task starting");
+        auto m = (ModemClass *) arg;
+        m->task_loop();
+        Serial.println("Net: modem task end");
+        vTaskDelete(NULL);
+    }, "Net: modem task", NET_TASK_STACK_SIZE, this, NET_MODEM_TASK_PRIO,
+        &this->task, NET_TASK_CORE < 0 ? tskNO_AFFINITY : NET_TASK_CORE);
+}
+
+// Before begin(), and from inside a job, there is nobody to hand the
+// request to; run it right away instead of deadlocking.
+bool ModemClass::runs_inline() {
+    return this->task == NULL || xTaskGetCurrentTaskHandle() == this->task;
+}
+
+ModemFuture ModemClass::submit(ModemPriority prio, ModemJob job,
+                               OnModemResult callback) {
+    ModemFuture future;
+    future.state = std::make_shared<ModemResultState>();
+
+    ModemRequest *req = new ModemRequest();
+    req->job      = job;
+    req->callback = callback;
+    req->state    = future.state;
+
+    if (this->runs_inline()) {
+        modem_run(this->modem, req);
+        delete req;
+        return future;
+    }
+
+    // blocks while this priority is full; the owner task drains it
+    xQueueSend(this->queues[prio], &req, portMAX_DELAY);
+    xSemaphoreGive(this->pending);
+    return future;
+}
+
+int ModemClass::call(ModemPriority prio, ModemJob job) {
+    if (this->runs_inline()) {
+        return job(this->modem);
+    }
+
+    ModemRequest  req;
+    ModemRequest *p = &req;
+    req.job    = std::move(job);
+    req.waiter = xTaskGetCurrentTaskHandle();
+
+    xQueueSend(this->queues[prio], &p, portMAX_DELAY);
+    xSemaphoreGive(this->pending);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    return req.result;
+}
+
+int ModemClass::alloc_mux() {
+    int mux = -1;
+    portENTER_CRITICAL(&this->mux_lock);
+    for (int m = 0; m < TINY_GSM_MUX_COUNT; ++m) {
+        if (!(this->muxes & (1UL << m))) {
+            this->muxes |= 1UL << m;
+            mux = m;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&this->mux_lock);
+    return mux;
+}
+
+void ModemClass::free_mux(int mux) {
+    if (mux < 0) {
+        return;
+    }
+    portENTER_CRITICAL(&this->mux_lock);
+    this->muxes &= ~(1UL << mux);
+    portEXIT_CRITICAL(&this->mux_lock);
+}
+
+void ModemClass::task_loop() {
+    for (;;) {
+        xSemaphoreTake(this->pending, portMAX_DELAY);
+
+        ModemRequest *req = NULL;
+        for (int p = 0; p < MODEM_PRIO_COUNT; ++p) {
+            if (xQueueReceive(this->queues[p], &req, 0) == pdTRUE) {
+                break;
+            }
+        }
+        if (req == NULL) {
+            continue;
+        }
+
+        if (req->waiter != NULL) {
+            // the caller owns req; it may be gone once notified
+            req->result = req->job(this->modem);
+            xTaskNotifyGive(req->waiter);
+            continue;
+        }
+        modem_run(this->modem, req);
+        delete req;
+    }
+}
+
+#endif // NET_HAS_GSM
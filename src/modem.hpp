@@ -0,0 +1,74 @@
+#ifndef NET_CLIENT_MODEM_H_
+#define NET_CLIENT_MODEM_H_
+
+// Included from net.hpp; without NET_HAS_GSM only the priorities are left
+
+#define MODEM_QUEUE_LENGTH 8 // pending requests per priority
+
+/*
+  All AT traffic goes through a single owner task. Requests are served
+  lowest value first, so data transfers are never stuck behind status
+  polls or telemetry queries.
+*/
+typedef enum {
+    MODEM_PRIO_DATA,      // socket connect/read/write/stop
+    MODEM_PRIO_STATUS,    // link and socket status polls
+    MODEM_PRIO_TELEMETRY, // signal quality, operator, IMEI, ...
+    MODEM_PRIO_COUNT
+} ModemPriority;
+
+#ifdef NET_HAS_GSM
+
+#include <memory>
+
+using ModemJob      = std::function<int(TinyGsm *modem)>;
+using OnModemResult = std::function<void(int result)>;
+
+struct ModemResultState {
+    SemaphoreHandle_t done;
+    volatile bool     ready  = false;
+    int               result = 0;
+
+    ModemResultState()  { this->done = xSemaphoreCreateBinary(); }
+    ~ModemResultState() { vSemaphoreDelete(this->done); }
+};
+
+class ModemFuture {
+public:
+    std::shared_ptr<ModemResultState> state;
+
+    bool ready();
+    int  get(uint32_t timeout_ms=UINT32_MAX); // 0 on timeout
+};
+
+class ModemClass {
+public:
+    TinyGsm          *modem   = NULL;
+    TaskHandle_t      task    = NULL;
+    SemaphoreHandle_t pending = NULL; // one count per queued request
+    QueueHandle_t     queues[MODEM_PRIO_COUNT];
+
+    void        begin(TinyGsm *modem);
+    bool        runs_inline();
+    ModemFuture submit(ModemPriority prio, ModemJob job,
+                       OnModemResult callback=NULL);
+    int         call(ModemPriority prio, ModemJob job); // waits on the caller's task notification
+    void        task_loop();
+
+    // Each TinyGsmClient needs a socket (mux) of its own; clients sharing
+    // one close each other's connection and take each other's data.
+    int         alloc_mux(); // -1 when all TINY_GSM_MUX_COUNT are in use
+    void        free_mux(int mux);
+
+private:
+    portMUX_TYPE      mux_lock = portMUX_INITIALIZER_UNLOCKED;
+    uint32_t          muxes    = 0; // one bit per mux in use
+};
+
+static_assert(TINY_GSM_MUX_COUNT <= 32, "ModemClass::muxes is a 32 bit mask");
+
+extern ModemClass NetModem;
+
+#endif // NET_HAS_GSM
+
+#endif // NET_CLIENT_MODEM_H_
@@ -1,13 +1,19 @@
 #include <Arduino.h>
 
 #include "net.hpp"
+#ifdef NET_HAS_WIFI
 #include "wifi.hpp"
+#endif
+#ifdef NET_HAS_GSM
 #include "gsm.hpp"
+#endif
 
 NetClass Net;
 
 NetClass::NetClass() {
+#ifdef NET_HAS_GSM
     this->modem = &global_modem;
+#endif
 }
 
 void NetClass::begin(NetMode mode,
@@ -24,9 +30,21 @@ void NetClass::begin(NetMode mode,
     this->gsm_passwd  = gsm_passwd;
     this->gsm_pin     = gsm_pin;
 
+#ifdef NET_HAS_GSM
+    // lets modem calls made before start() run inline
+    NetModem.modem = this->modem;
+#endif
+
     // disable wifi if no ssid is provided
     if (this->wifi_ssid == NULL)
         this->mode = NET_GSM_ONLY;
+
+    // single-link builds ignore the other link
+#if !defined(NET_HAS_WIFI)
+    this->mode = NET_GSM_ONLY;
+#elif !defined(NET_HAS_GSM)
+    this->mode = NET_WIFI_ONLY;
+#endif
 }
 
 void NetClass::start() {
@@ -35,6 +53,9 @@ void NetClass::start() {
         return;
     }
 
+    NetMeter.begin();
+
+#ifdef NET_HAS_GSM
     if (this->mode != NET_WIFI_ONLY) {
         const bool once = true;
         for (;;) {
@@ -50,6 +71,11 @@ void NetClass::start() {
                 delay(500);
             }
         }
+        // from here on, the modem is only touched by its owner task
+        NetModem.begin(this->modem);
+        if (this->gsm_connected) {
+            this->gsm_submit_info();
+        }
         //this->gsm_task(false);
         /*xTaskCreate([](void *arg) {
             Serial.println("Net: GSM task starting");
@@ -59,7 +85,9 @@ void NetClass::start() {
             vTaskDelete(NULL);
             }, "Net: GSM task", 10000, this, 1, NULL);*/
     }
+#endif
 
+#ifdef NET_HAS_WIFI
     if (this->mode != NET_GSM_ONLY) {
         this->wifi_connected =
             wifi_start(this->wifi_ssid, this->wifi_passwd,
@@ -72,6 +100,7 @@ void NetClass::start() {
             vTaskDelete(NULL);
         }, "Net: WiFi task", 10000, this, 1, NULL);
     }
+#endif
 
     this->started = true;
 
@@ -86,44 +115,74 @@ void NetClass::run_onchange() {
 
 void NetClass::end() {
     switch (this->connection) {
-    case NET_CON_GSM:  gsm_end(this->modem); break;
+#ifdef NET_HAS_GSM
+    case NET_CON_GSM:
+        NetModem.call(MODEM_PRIO_STATUS, [](TinyGsm *modem) {
+            gsm_end(modem);
+            return 0;
+        });
+        break;
+#endif
+#ifdef NET_HAS_WIFI
     case NET_CON_WIFI: wifi_end();           break;
+#endif
+    default:                                 break;
     }
     this->connection = NET_CON_NONE;
+    NetMeter.save();
     this->run_onchange();
 }
 
 bool NetClass::gsm_connect_again() {
+#ifdef NET_HAS_GSM
     if (this->mode == NET_WIFI_ONLY) {
         return false;
     }
 
-    this->gsm_connected = gsm_connect(this->modem, this->gsm_pin,
-                                      this->gsm_apn,
-                                      this->gsm_user, this->gsm_passwd);
+    this->gsm_connected = NetModem.call(MODEM_PRIO_STATUS, [this](TinyGsm *modem) {
+        return (int) gsm_connect(modem, this->gsm_pin,
+                                 this->gsm_apn,
+                                 this->gsm_user, this->gsm_passwd);
+    });
     if (this->gsm_connected) {
         this->last_connection_at = millis();
         Serial.println("GSM connected!");
+        this->gsm_submit_info();
     }
     this->loop();
     return this->gsm_connected;
+#else
+    return false;
+#endif
+}
+
+void NetClass::gsm_submit_info() {
+#ifdef NET_HAS_GSM
+    NetModem.submit(MODEM_PRIO_TELEMETRY, [](TinyGsm *modem) {
+        gsm_print_info(modem);
+        return 0;
+    });
+#endif
 }
 
 void NetClass::gsm_task(bool loop) {
+#ifdef NET_HAS_GSM
     if (this->mode == NET_WIFI_ONLY) {
         return;
     }
 
     do {
-        if (this->modem && this->modem->isNetworkConnected()) {
+        if (this->modem_network_connected()) {
             delay(1000);
             continue;
         }
         this->gsm_connect_again();
     } while (loop);
+#endif
 }
 
 void NetClass::wifi_task(bool loop) {
+#ifdef NET_HAS_WIFI
     if (this->mode == NET_GSM_ONLY) {
         return;
     }
@@ -142,6 +201,7 @@ void NetClass::wifi_task(bool loop) {
         }
         this->loop();
     } while (loop);
+#endif
 }
 
 void NetClass::loop() {
@@ -159,37 +219,59 @@ void NetClass::loop() {
     }
 }
 
+bool NetClass::modem_network_connected() {
+#ifdef NET_HAS_GSM
+    return this->modem && NetModem.call(MODEM_PRIO_STATUS, [](TinyGsm *modem) {
+        return (int) modem->isNetworkConnected();
+    });
+#else
+    return false;
+#endif
+}
+
 bool NetClass::connected() {
     return this->connection != NET_CON_NONE &&
+#ifdef NET_HAS_WIFI
         ((WiFi.status() == WL_CONNECTED) ||
-         (this->modem && this->modem->isNetworkConnected()));
+         this->modem_network_connected());
+#else
+        this->modem_network_connected();
+#endif
 }
 
 // Client interface
 
-NetClient::NetClient() {
-    const bool prefer_secure = true;
+NetClient::NetClient() : NetClient(true) {}
+
+NetClient::NetClient(bool prefer_secure) {
     this->connection_at = Net.last_connection_at;
     this->client_connection = Net.connection;
 
     Client *c         = NULL;
-    WiFiClient *wific = NULL;
     switch (this->client_connection) {
-    case NET_CON_WIFI:
-        wific = new WiFiClient();
+#ifdef NET_HAS_WIFI
+    case NET_CON_WIFI: {
+        WiFiClient *wific = new WiFiClient();
         wific->setTimeout(WIFI_TIMEOUT / 1000);
         c = wific;
         DBG("NetClient::NetClient(): CREATED WiFiClient");
         break;
+    }
+#endif
+#ifdef NET_HAS_GSM
     case NET_CON_GSM:
         if (Net.modem == NULL) {
             DBG("NetClient::NetClient(): ERROR: modem is NULL");
             c = NULL;
+        } else if ((this->mux = NetModem.alloc_mux()) < 0) {
+            DBG("NetClient::NetClient(): ERROR: all modem sockets in use");
+            c = NULL;
         } else {
-            c = new TinyGsmClient(*Net.modem);
-            DBG("NetClient::NetClient(): CREATED TinyGsmClient");
+            c = new TinyGsmClient(*Net.modem, this->mux);
+            DBG("NetClient::NetClient(): CREATED TinyGsmClient", this->mux);
         }
         break;
+#endif
     case NET_CON_NONE:
         DBG("NetClient::NetClient(): ERROR: Net not connected");
         c = NULL;
@@ -217,12 +299,26 @@ NetClient::NetClient() {
 
 // TODO: validate this fixes the memory leak
 NetClient::~NetClient() {
-    if (this->real_client != NULL) {
-        delete this->real_client;
-    }
-    if (this->real_client_2 != NULL) {
-        delete this->real_client_2;
+    NetKeepalive.remove(this);
+
+    // SSLClient stops its inner client when deleted, which talks to the modem
+    auto release = [this]() {
+        if (this->real_client != NULL) {
+            delete this->real_client;
+        }
+        if (this->real_client_2 != NULL) {
+            delete this->real_client_2;
+        }
+        return 0;
+    };
+#ifdef NET_HAS_GSM
+    if (this->client_connection == NET_CON_GSM) {
+        NetModem.call(MODEM_PRIO_DATA, [&](TinyGsm *) { return release(); });
+        NetModem.free_mux(this->mux);
+        return;
     }
+#endif
+    release();
 }
 
 #define NET_CALL_PRINT(call, retval)                            \
@@ -238,29 +334,52 @@ NetClient::~NetClient() {
                       millis(), con, #call, retval);            \
     }
 
-#define NET_CALL_BASE(call, ret, retret, print)             \
+// GSM calls are handed to the modem owner task, see modem.hpp
+#ifdef NET_HAS_GSM
+#define NET_CALL_GSM(fn, prio, ret)                         \
+        if (this->client_connection == NET_CON_GSM) {       \
+            NetModem.call(prio, [&](TinyGsm *) {            \
+                ret this->real_client->fn;                  \
+                return 0;                                   \
+            });                                             \
+        } else
+#else
+#define NET_CALL_GSM(fn, prio, ret)
+#endif
+
+#define NET_CALL_BASE(fn, prio, ret, retret, print)         \
     {                                                       \
         int retval;                                         \
-        if (Net.connection != this->client_connection    || \
-            this->client_connection == NET_CON_NONE      || \
-            Net.last_connection_at > this->connection_at || \
-            this->real_client == NULL                    || \
-            (this->client_connection == NET_CON_GSM &&      \
-             !Net.can_use_gsm)) {                           \
+        if (!this->usable()) {                              \
             ret 0;                                          \
-        } else {                                            \
-            ret this->real_client->call;                    \
+        } else NET_CALL_GSM(fn, prio, ret) {                \
+            ret this->real_client->fn;                      \
         }                                                   \
-        if (print) NET_CALL_PRINT(call, retval);            \
+        if (print) NET_CALL_PRINT(fn, retval);              \
         retret;                                             \
     }
 
-#define NET_CALL(call, print)      NET_CALL_BASE(call, retval =, return retval, print)
-#define NET_CALL_VOID(call, print) NET_CALL_BASE(call, (void), (void) 0, print)
+#define NET_CALL(call, prio, print)      NET_CALL_BASE(call, prio, retval =, return retval, print)
+#define NET_CALL_VOID(call, prio, print) NET_CALL_BASE(call, prio, (void), (void) 0, print)
+
+// counts the bytes moved by `call' against this client and its link;
+// nothing is counted when the real client was not called
+#define NET_CALL_IO(call, prio, in, out, print)                 \
+    {                                                           \
+        if (!this->usable()) return 0;                          \
+        NET_CALL_BASE(call, prio, retval =, {                   \
+                this->count(in, out);                           \
+                return retval;                                  \
+            }, print);                                          \
+    }
 
 #define NET_CALL_CONNECT(call, print)                           \
     {                                                           \
-        NET_CALL_BASE(call, retval =, {                         \
+        if (NetMeter.deferred(this->client_connection,          \
+                              this->priority)) {                \
+            return 0;                                           \
+        }                                                       \
+        NET_CALL_BASE(call, MODEM_PRIO_DATA, retval =, {        \
                 if (retval == 0) {                              \
                     /* because sometimes Net.working() */       \
                     /* stay true with WiFi*/                    \
@@ -270,22 +389,167 @@ NetClient::~NetClient() {
                     }                                           \
                 } else {                                        \
                     Net.connect_failed_count = 0;               \
+                    NetKeepalive.add(this);                     \
                 }                                               \
                 return retval;                                  \
             }, print);                                          \
     }
 
-int     NetClient::connect(IPAddress ip, uint16_t port)                      NET_CALL_CONNECT(connect(ip,   port),               false);
-int     NetClient::connect(const char *host, uint16_t port)                  NET_CALL_CONNECT(connect(host, port),               false);
-int     NetClient::connect(IPAddress ip, uint16_t port, int32_t timeout)     NET_CALL_CONNECT(connect(ip,   port),               false);
-int     NetClient::connect(const char *host, uint16_t port, int32_t timeout) NET_CALL_CONNECT(connect(host, port),               false);
-size_t  NetClient::write(uint8_t b)                                          NET_CALL(write(b),                                  false);
-size_t  NetClient::write(const uint8_t *buf, size_t size)                    NET_CALL(write(buf, size),                          false);
-size_t  NetClient::write(const char *buf)                                    NET_CALL(write((const uint8_t *) buf, strlen(buf)), false);
-int     NetClient::available()                                               NET_CALL(available(),                               false);
-int     NetClient::read()                                                    NET_CALL(read(),                                    false);
-int     NetClient::read(uint8_t *buf, size_t size)                           NET_CALL(read(buf, size),                           false);
-int     NetClient::peek()                                                    NET_CALL(peek(),                                    false);
-void    NetClient::flush()                                                   NET_CALL_VOID(flush(),                              false);
-void    NetClient::stop()                                                    NET_CALL_VOID(stop(); delete this->real_client,     false);
-uint8_t NetClient::connected()                                               NET_CALL(connected(),                               false);
+// false once the link changed, or a newer connection was made
+bool NetClient::usable() {
+    return Net.connection == this->client_connection  &&
+        this->client_connection != NET_CON_NONE       &&
+        Net.last_connection_at <= this->connection_at &&
+        this->real_client != NULL                     &&
+        (this->client_connection != NET_CON_GSM || Net.can_use_gsm);
+}
+
+void NetClient::count(size_t in, size_t out) {
+    this->bytes.in  += in;
+    this->bytes.out += out;
+    NetMeter.count(this->client_connection, in, out);
+    if (out > 0) NetKeepalive.on_send(this);
+    if (in > 0)  NetKeepalive.on_receive(this);
+}
+
+void NetClient::stop() {
+    NetKeepalive.remove(this);
+    this->last_activity = 0;
+    this->stop_link();
+}
+
+uint8_t NetClient::connected() {
+    if (!this->usable()) {
+        return 0; // not a drop of this connection, the link went away
+    }
+    uint8_t res = this->connected_link();
+    if (!res && this->last_activity != 0 && this->usable()) {
+        // first time the real client reports this one down;
+        // tells NetKeepalive how long it was idle
+        NetKeepalive.on_drop(this);
+        this->last_activity = 0;
+    }
+    return res;
+}
+
+size_t NetClient::write(uint8_t b) {
+    return this->write(&b, 1);
+}
+
+size_t NetClient::write(const char *buf) {
+    return this->write((const uint8_t *) buf, strlen(buf));
+}
+
+size_t NetClient::write(const uint8_t *buf, size_t size) {
+    // low priority GSM traffic is throttled or deferred near the budget
+    size = NetMeter.allow(this->client_connection, this->priority, size);
+    if (size == 0) {
+        return 0;
+    }
+    return this->write_link(buf, size);
+}
+
+int     NetClient::connect(IPAddress ip, uint16_t port)                      NET_CALL_CONNECT(connect(ip,   port),                                            false);
+int     NetClient::connect(const char *host, uint16_t port)                  NET_CALL_CONNECT(connect(host, port),                                            false);
+int     NetClient::connect(IPAddress ip, uint16_t port, int32_t timeout)     NET_CALL_CONNECT(connect(ip,   port),                                            false);
+int     NetClient::connect(const char *host, uint16_t port, int32_t timeout) NET_CALL_CONNECT(connect(host, port),                                            false);
+size_t  NetClient::write_link(const uint8_t *buf, size_t size)               NET_CALL_IO(write(buf, size), MODEM_PRIO_DATA,   0, retval,                      false);
+int     NetClient::available()                                               NET_CALL(available(),         MODEM_PRIO_STATUS,                                 false);
+int     NetClient::read()                                                    NET_CALL_IO(read(),           MODEM_PRIO_DATA,   retval >= 0 ? 1 : 0, 0,         false);
+int     NetClient::read(uint8_t *buf, size_t size)                           NET_CALL_IO(read(buf, size),  MODEM_PRIO_DATA,   retval > 0 ? retval : 0, 0,     false);
+int     NetClient::peek()                                                    NET_CALL(peek(),              MODEM_PRIO_DATA,                                   false);
+void    NetClient::flush()                                                   NET_CALL_VOID(flush(),        MODEM_PRIO_DATA,                                   false);
+void    NetClient::stop_link()                                               NET_CALL_VOID(stop(); delete this->real_client; this->real_client = NULL, MODEM_PRIO_DATA, false);
+uint8_t NetClient::connected_link()                                          NET_CALL(connected(),         MODEM_PRIO_STATUS,                                 false);
+
+#ifdef NET_ADD_SSL
+
+// Secure client interface
+
+// Certificates are only known once the caller configured them, so the
+// SSLClient layer is added on the first connect()
+void NetClientSecure::secure() {
+    if (this->real_client == NULL || this->real_client_2 != NULL) {
+        return;
+    }
+    SSLClient *c_ssl = new SSLClient(this->real_client);
+    if (this->ca_cert != NULL) {
+        c_ssl->setCACert(this->ca_cert);
+    }
+    if (this->certificate != NULL) {
+        c_ssl->setCertificate(this->certificate);
+    }
+    if (this->private_key != NULL) {
+        c_ssl->setPrivateKey(this->private_key);
+    }
+    this->real_client_2 = this->real_client;
+    this->real_client   = c_ssl;
+}
+
+bool NetClientSecure::uncork() {
+    if (this->corked == 0) {
+        return true;
+    }
+    size_t n = NetClient::write(this->cork, this->corked);
+    if (n < this->corked) {
+        memmove(this->cork, this->cork + n, this->corked - n);
+    }
+    this->corked -= n;
+    return this->corked == 0;
+}
+
+size_t NetClientSecure::write(const uint8_t *buf, size_t size) {
+    if (!this->open || !this->usable()) {
+        return 0; // would be reported written, then dropped by uncork()
+    }
+    if (size <= NET_SECURE_CORK_SMALL &&
+        this->corked + size <= NET_SECURE_CORK_SIZE) {
+        memcpy(this->cork + this->corked, buf, size);
+        this->corked += size;
+        return size;
+    }
+
+    size_t sent = 0;
+    if (this->corked > 0) {
+        // held back header + as much of the payload as fits, in one record
+        sent = min(size, (size_t) NET_SECURE_CORK_SIZE - this->corked);
+        memcpy(this->cork + this->corked, buf, sent);
+        this->corked += sent;
+        if (!this->uncork()) {
+            return sent; // the rest must not overtake what is still held
+        }
+    }
+    if (sent < size) {
+        sent += NetClient::write(buf + sent, size - sent);
+    }
+    return sent;
+}
+
+int NetClientSecure::connect(IPAddress ip, uint16_t port) {
+    this->secure();
+    return this->opened(NetClient::connect(ip, port));
+}
+
+int NetClientSecure::connect(const char *host, uint16_t port) {
+    this->secure();
+    return this->opened(NetClient::connect(host, port));
+}
+
+int NetClientSecure::connect(IPAddress ip, uint16_t port, int32_t timeout) {
+    this->secure();
+    return this->opened(NetClient::connect(ip, port, timeout));
+}
+
+int NetClientSecure::connect(const char *host, uint16_t port, int32_t timeout) {
+    this->secure();
+    return this->opened(NetClient::connect(host, port, timeout));
+}
+
+int     NetClientSecure::available()                     { this->uncork(); return NetClient::available();     }
+int     NetClientSecure::read()                          { this->uncork(); return NetClient::read();          }
+int     NetClientSecure::read(uint8_t *buf, size_t size) { this->uncork(); return NetClient::read(buf, size); }
+int     NetClientSecure::peek()                          { this->uncork(); return NetClient::peek();          }
+void    NetClientSecure::flush()                         { this->uncork(); NetClient::flush();                }
+void    NetClientSecure::stop()                          { this->uncork(); NetClient::stop(); this->open = false; }
+
+#endif
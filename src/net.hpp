@@ -1,13 +1,40 @@
 #ifndef NET_CLIENT_H_
 #define NET_CLIENT_H_
 
+#include <Arduino.h>
+
+/*
+  Define one of these (as a build flag, the library is compiled on its own)
+  to leave the other transport out of the build entirely.
+*/
+//#define NET_LINK_WIFI_ONLY
+//#define NET_LINK_GSM_ONLY
+#if defined(NET_LINK_WIFI_ONLY) && defined(NET_LINK_GSM_ONLY)
+#error "NET_LINK_WIFI_ONLY and NET_LINK_GSM_ONLY are mutually exclusive"
+#endif
+#ifndef NET_LINK_WIFI_ONLY
+#define NET_HAS_GSM
+#endif
+#ifndef NET_LINK_GSM_ONLY
+#define NET_HAS_WIFI
+#endif
+
+#ifdef NET_HAS_GSM
 #define TINY_GSM_MODEM_SIM7600 // SIMA7670 Compatible with SIM7600 AT instructions
 #define TINY_GSM_DEBUG Serial
 #include <TinyGsmClient.h>
+#elif !defined(DBG)
+#define DBG(...) // normally provided by TinyGSM
+#endif
 
+#ifdef NET_HAS_WIFI
 #include <WiFi.h>
+#endif
 
+// define NET_NO_SSL to build without SSLClient
+#ifndef NET_NO_SSL
 #define NET_ADD_SSL
+#endif
 #ifdef NET_ADD_SSL
 #include <SSLClient.h>
 #endif
@@ -17,6 +44,11 @@
 #define NET_CONNECT_TIMEOUT      5000  // ms
 #define WIFI_TIMEOUT             3000  // ms; not really effective
 #define WIFI_DOUBLE_CHECK_PERIOD 10000 // ms
+#define NET_MODEM_TASK_PRIO      2     // above the WiFi task so the UART stays busy
+#define NET_SECURE_CORK_SIZE     1024  // bytes; NetClientSecure write coalescing buffer
+#define NET_SECURE_CORK_SMALL    16    // bytes; writes up to this size are held back
+
+#include "modem.hpp"
 
 typedef enum {
     NET_WIFI_FIRST,
@@ -32,11 +64,17 @@ typedef enum {
 
 using OnNetChange = std::function<void(bool connected, NetConnection mode)>;
 
+#include "meter.hpp"
+#include "keepalive.hpp"
+#include "timeline.hpp"
+
 class NetClass {
 public:
     NetMode       mode           = NET_WIFI_FIRST;
     NetConnection connection     = NET_CON_NONE;
+#ifdef NET_HAS_GSM
     TinyGsm      *modem          = NULL;
+#endif
 
     const char *wifi_ssid;
     const char *wifi_passwd;
@@ -75,7 +113,9 @@ public:
     void    start();
     void    end();
     bool    connected();
+    bool    modem_network_connected();
     bool    gsm_connect_again();
+    void    gsm_submit_info();
     void    gsm_task(bool loop=true);
     void    wifi_task(bool loop=true);
     void    loop();
@@ -92,13 +132,24 @@ public:
     Client        *real_client_2 = NULL; // if ssl is used, this is the inner client
     unsigned long  connection_at;        // used to stop when a newer connection is made
     NetConnection  client_connection;    // used to stop when mode is changed
+    NetPriority    priority = NET_PRIO_NORMAL; // see NetMeter budget
+    NetByteCount   bytes;                // moved by this client
+    unsigned long  last_activity = 0;    // see NetKeepalive
+    unsigned long  pending_gap   = 0;    // idle gap before the last unanswered send
+    OnNetKeepalive onkeepalive   = NULL; // overrides NetKeepalive.onkeepalive
+#ifdef NET_HAS_GSM
+    int            mux           = -1;   // of the TinyGsmClient, see NetModem.alloc_mux()
+#endif
 
     ~NetClient();
     NetClient();
+    explicit NetClient(bool prefer_secure);
+#ifdef NET_HAS_WIFI
     NetClient(WiFiClient c) : NetClient() {
         // Ignored. Just to compile WebSocketsServer at
         // new WEBSOCKETS_NETWORK_CLASS(_server->available());
     }
+#endif
 
     IPAddress remoteIP() {
         Serial.println("remoteIP() not implemented because of TinyGSM");
@@ -113,16 +164,76 @@ public:
     size_t  write(uint8_t b);
     size_t  write(const uint8_t *buf, size_t size);
     size_t  write(const char *buf);
+    size_t  write_link(const uint8_t *buf, size_t size); // skips the budget
+    void    count(size_t in, size_t out);
     int     available();
     int     read();
     int     read(uint8_t *buf, size_t size);
     int     peek();
     void    flush();
     void    stop();
+    void    stop_link();
     uint8_t connected();
+    uint8_t connected_link();
+    bool    usable();
     operator bool() { return this->connected(); }
 };
 
+#ifdef NET_ADD_SSL
+/*
+  TLS client with its own certificates, independent of Net.ssl_ca_cert.
+  Meant as WEBSOCKETS_NETWORK_SSL_CLASS; see examples/arduinoWebSockets.h.patch.
+
+  Small writes (a WebSocket frame header and mask) are held back and sent
+  together with the next write, so a frame header shares its TLS record
+  and link-layer send with the first NET_SECURE_CORK_SIZE bytes of the
+  frame; the rest of a longer payload follows in a second record. Held
+  bytes are sent by any write that is not small, and before read(),
+  available(), peek(), flush() and stop(). connected() does not send
+  them, as it is polled between the pieces of a frame. Writes on a client
+  that is not connected return 0 instead of being held.
+*/
+class NetClientSecure : public NetClient {
+public:
+    const char *ca_cert     = NULL; // NULL means the server is not verified
+    const char *certificate = NULL;
+    const char *private_key = NULL;
+
+    NetClientSecure() : NetClient(false) {}
+#ifdef NET_HAS_WIFI
+    NetClientSecure(WiFiClient c) : NetClientSecure() {}
+#endif
+
+    void    setCACert(const char *root_ca)     { this->ca_cert     = root_ca; }
+    void    setCertificate(const char *cert)   { this->certificate = cert;    }
+    void    setPrivateKey(const char *key)     { this->private_key = key;     }
+    void    setInsecure()                      { this->ca_cert     = NULL;    }
+
+    using NetClient::write;
+
+    int     connect(IPAddress ip, uint16_t port);
+    int     connect(const char *host, uint16_t port);
+    int     connect(IPAddress ip, uint16_t port, int32_t timeout);
+    int     connect(const char *host, uint16_t port, int32_t timeout);
+    size_t  write(const uint8_t *buf, size_t size);
+    int     available();
+    int     read();
+    int     read(uint8_t *buf, size_t size);
+    int     peek();
+    void    flush();
+    void    stop();
+
+private:
+    uint8_t cork[NET_SECURE_CORK_SIZE];
+    size_t  corked = 0;
+    bool    open   = false; // connect() succeeded and stop() was not called since
+
+    void    secure();
+    bool    uncork();
+    int     opened(int result) { this->open = result != 0; return result; }
+};
+#endif
+
 // utils
 
 void http_get_req(const char *server, const char *resource="/");
@@ -0,0 +1,207 @@
+#ifndef NET_CLIENT_POLICY_H_
+#define NET_CLIENT_POLICY_H_
+
+#include "net.hpp"
+
+/*
+  Compile-time specialized clients for builds that only ever use one
+  link. Unlike NetClient, the transport (and the TLS layer, if any) is a
+  concrete type, so every call is resolved statically and the checks
+  that cannot fail for a single link are folded away. To also leave the
+  other transport out of the library, build with NET_LINK_WIFI_ONLY or
+  NET_LINK_GSM_ONLY (see net.hpp).
+
+    NetClientT<NET_LINK_GSM, false> c; // or the aliases below
+*/
+
+#define NET_LINK_WIFI 0x1
+#define NET_LINK_GSM  0x2
+
+template <int Link> struct NetLinkPolicy;
+
+#ifdef NET_HAS_WIFI
+template <> struct NetLinkPolicy<NET_LINK_WIFI> {
+    typedef WiFiClient client_t;
+    static const NetConnection connection = NET_CON_WIFI;
+
+    static client_t *create(int *) {
+        client_t *c = new WiFiClient();
+        c->setTimeout(WIFI_TIMEOUT / 1000);
+        return c;
+    }
+
+    static void release(int) {}
+
+    template <typename F>
+    static int run(ModemPriority, F f) { return f(); }
+};
+#endif
+
+#ifdef NET_HAS_GSM
+template <> struct NetLinkPolicy<NET_LINK_GSM> {
+    typedef TinyGsmClient client_t;
+    static const NetConnection connection = NET_CON_GSM;
+
+    static client_t *create(int *mux) {
+        if (Net.modem == NULL) {
+            DBG("NetClientT: ERROR: modem is NULL");
+            return NULL;
+        }
+        if ((*mux = NetModem.alloc_mux()) < 0) {
+            DBG("NetClientT: ERROR: all modem sockets in use");
+            return NULL;
+        }
+        return new TinyGsmClient(*Net.modem, *mux);
+    }
+
+    static void release(int mux) { NetModem.free_mux(mux); }
+
+    template <typename F>
+    static int run(ModemPriority prio, F f) {
+        return NetModem.call(prio, [&](TinyGsm *) { return (int) f(); });
+    }
+};
+#endif
+
+template <int Link, bool Tls> struct NetTlsPolicy {
+    static_assert(!Tls, "NetClientT<Link, true> requires SSLClient, build without NET_NO_SSL");
+    typedef typename NetLinkPolicy<Link>::client_t client_t;
+    static client_t *wrap(client_t *c) { return c; }
+};
+
+#ifdef NET_ADD_SSL
+template <int Link> struct NetTlsPolicy<Link, true> {
+    typedef SSLClient client_t;
+    static client_t *wrap(typename NetLinkPolicy<Link>::client_t *c) {
+        if (c == NULL) {
+            return NULL;
+        }
+        SSLClient *c_ssl = new SSLClient(c);
+        c_ssl->setCACert(Net.ssl_ca_cert);
+        return c_ssl;
+    }
+};
+#endif
+
+template <int Link, bool Tls>
+class NetClientT : public Client {
+public:
+    typedef NetLinkPolicy<Link>                link_t;
+    typedef typename link_t::client_t          inner_t;
+    typedef typename NetTlsPolicy<Link, Tls>::client_t client_t;
+
+    client_t      *real_client   = NULL;
+    inner_t       *real_client_2 = NULL; // same as real_client without TLS
+    unsigned long  connection_at;
+    NetPriority    priority = NET_PRIO_NORMAL;
+    NetByteCount   bytes;
+    int            mux      = -1; // GSM only
+
+    NetClientT() {
+        this->connection_at = Net.last_connection_at;
+        if (Net.connection == link_t::connection) {
+            this->real_client_2 = link_t::create(&this->mux);
+            this->real_client   = NetTlsPolicy<Link, Tls>::wrap(this->real_client_2);
+        } else {
+            DBG("NetClientT: ERROR: link is not connected");
+        }
+    }
+
+    ~NetClientT() {
+        link_t::run(MODEM_PRIO_DATA, [this]() {
+            if ((void *) this->real_client != (void *) this->real_client_2) {
+                delete this->real_client;
+            }
+            delete this->real_client_2;
+            return 0;
+        });
+        link_t::release(this->mux);
+    }
+
+    // Only a link drop or a newer connection can invalidate a single-link
+    // client; the GSM term is a constant false for WiFi.
+    bool usable() {
+        return Net.connection == link_t::connection              &&
+            Net.last_connection_at <= this->connection_at        &&
+            this->real_client != NULL                            &&
+            (link_t::connection != NET_CON_GSM || Net.can_use_gsm);
+    }
+
+#define NET_POLICY_CALL(call, prio)                                 \
+    {                                                               \
+        if (!this->usable()) return 0;                              \
+        return link_t::run(prio, [&]() {                            \
+            return this->real_client->client_t::call;               \
+        });                                                         \
+    }
+
+#define NET_POLICY_CALL_IO(call, prio, in, out)                     \
+    {                                                               \
+        if (!this->usable()) return 0;                              \
+        int retval = link_t::run(prio, [&]() {                      \
+            return this->real_client->client_t::call;               \
+        });                                                         \
+        this->count(in, out);                                       \
+        return retval;                                              \
+    }
+
+#define NET_POLICY_CALL_VOID(call, prio)                            \
+    {                                                               \
+        if (!this->usable()) return;                                \
+        link_t::run(prio, [&]() {                                   \
+            this->real_client->client_t::call;                      \
+            return 0;                                               \
+        });                                                         \
+    }
+
+    void count(size_t in, size_t out) {
+        this->bytes.in  += in;
+        this->bytes.out += out;
+        NetMeter.count(link_t::connection, in, out);
+    }
+
+    size_t write(uint8_t b)         { return this->write(&b, 1); }
+    size_t write(const char *buf)   { return this->write((const uint8_t *) buf, strlen(buf)); }
+
+    size_t write(const uint8_t *buf, size_t size) {
+        size = NetMeter.allow(link_t::connection, this->priority, size);
+        if (size == 0) {
+            return 0;
+        }
+        return this->write_link(buf, size);
+    }
+
+    int     connect(IPAddress ip, uint16_t port)                      NET_POLICY_CALL(connect(ip,   port),                    MODEM_PRIO_DATA)
+    int     connect(const char *host, uint16_t port)                  NET_POLICY_CALL(connect(host, port),                    MODEM_PRIO_DATA)
+    int     connect(IPAddress ip, uint16_t port, int32_t timeout)     NET_POLICY_CALL(connect(ip,   port),                    MODEM_PRIO_DATA)
+    int     connect(const char *host, uint16_t port, int32_t timeout) NET_POLICY_CALL(connect(host, port),                    MODEM_PRIO_DATA)
+    size_t  write_link(const uint8_t *buf, size_t size)               NET_POLICY_CALL_IO(write(buf, size),  MODEM_PRIO_DATA, 0, retval)
+    int     available()                                               NET_POLICY_CALL(available(),                            MODEM_PRIO_STATUS)
+    int     read()                                                    NET_POLICY_CALL_IO(read(),            MODEM_PRIO_DATA, retval >= 0 ? 1 : 0, 0)
+    int     read(uint8_t *buf, size_t size)                           NET_POLICY_CALL_IO(read(buf, size),   MODEM_PRIO_DATA, retval > 0 ? retval : 0, 0)
+    int     peek()                                                    NET_POLICY_CALL(peek(),                                 MODEM_PRIO_DATA)
+    void    flush()                                                   NET_POLICY_CALL_VOID(flush(),                           MODEM_PRIO_DATA)
+    void    stop()                                                    NET_POLICY_CALL_VOID(stop(),                            MODEM_PRIO_DATA)
+    uint8_t connected()                                               NET_POLICY_CALL(connected(),                            MODEM_PRIO_STATUS)
+    operator bool() { return this->connected(); }
+
+#undef NET_POLICY_CALL
+#undef NET_POLICY_CALL_IO
+#undef NET_POLICY_CALL_VOID
+};
+
+#ifdef NET_HAS_WIFI
+typedef NetClientT<NET_LINK_WIFI, false> NetClientWiFi;
+#ifdef NET_ADD_SSL
+typedef NetClientT<NET_LINK_WIFI, true>  NetClientWiFiTls;
+#endif
+#endif
+
+#ifdef NET_HAS_GSM
+typedef NetClientT<NET_LINK_GSM,  false> NetClientGsm;
+#ifdef NET_ADD_SSL
+typedef NetClientT<NET_LINK_GSM,  true>  NetClientGsmTls;
+#endif
+#endif
+
+#endif // NET_CLIENT_POLICY_H_
@@ -0,0 +1,343 @@
+#include <Arduino.h>
+#include <HttpClient.h>
+#include <mbedtls/sha256.h>
+#ifdef ESP32
+#include <Update.h>
+#endif
+
+#include "net.hpp"
+#include "ota.hpp"
+
+struct OtaBlock {
+    uint8_t *buf;
+    size_t   len; // a NULL buf ends the writer task
+};
+
+struct OtaPipe {
+    OtaWriter              *writer;
+    QueueHandle_t           free_q = NULL; // uint8_t *
+    QueueHandle_t           full_q = NULL; // OtaBlock
+    SemaphoreHandle_t       done   = NULL;
+    uint8_t                *bufs[2] = { NULL, NULL };
+    mbedtls_sha256_context  sha;
+    volatile bool           failed = false;
+};
+
+// Writers ==================
+
+#ifdef ESP32
+bool OtaUpdateWriter::begin(size_t size) {
+    if (!Update.begin(size > 0 ? size : UPDATE_SIZE_UNKNOWN)) {
+        DBG("OtaUpdateWriter: begin failed:", Update.errorString());
+        return false;
+    }
+    return true;
+}
+
+bool OtaUpdateWriter::write(const uint8_t *buf, size_t size) {
+    return Update.write((uint8_t *) buf, size) == size;
+}
+
+bool OtaUpdateWriter::end(bool ok) {
+    if (!ok) {
+        Update.abort();
+        return false;
+    }
+    if (!Update.end(true)) {
+        DBG("OtaUpdateWriter: end failed:", Update.errorString());
+        return false;
+    }
+    return true;
+}
+#endif
+
+bool OtaFileWriter::begin(size_t) {
+    this->file = fopen(this->path, "wb");
+    if (this->file == NULL) {
+        DBG("OtaFileWriter: cannot open", this->path);
+        return false;
+    }
+    return true;
+}
+
+bool OtaFileWriter::write(const uint8_t *buf, size_t size) {
+    return fwrite(buf, 1, size, this->file) == size;
+}
+
+bool OtaFileWriter::end(bool ok) {
+    if (this->file == NULL) {
+        return false;
+    }
+    bool closed = fclose(this->file) == 0;
+    this->file = NULL;
+    if (!ok) {
+        remove(this->path);
+        return false;
+    }
+    return closed;
+}
+
+// Pipeline ==================
+
+static void ota_writer_task(void *arg) {
+    auto p = (OtaPipe *) arg;
+    OtaBlock b;
+    for (;;) {
+        xQueueReceive(p->full_q, &b, portMAX_DELAY);
+        if (b.buf == NULL) {
+            break;
+        }
+        if (!p->failed) {
+            if (p->writer->write(b.buf, b.len)) {
+                mbedtls_sha256_update(&p->sha, b.buf, b.len);
+            } else {
+                DBG("OTA: write failed");
+                p->failed = true;
+            }
+        }
+        xQueueSend(p->free_q, &b.buf, portMAX_DELAY);
+    }
+    xSemaphoreGive(p->done);
+    vTaskDelete(NULL);
+}
+
+static void ota_send_block(OtaPipe *p, uint8_t *buf, size_t len, size_t *offset) {
+    OtaBlock b = { buf, len };
+    xQueueSend(p->full_q, &b, portMAX_DELAY);
+    *offset += len;
+}
+
+// Content-Range: bytes <first>-<last>/<complete length or *>
+static bool ota_parse_range(const char *value, size_t *first, size_t *complete) {
+    unsigned long f, l;
+    char          c[16];
+    if (sscanf(value, "bytes %lu-%lu/%15s", &f, &l, c) != 3 || l < f) {
+        return false;
+    }
+    *first    = f;
+    *complete = strcmp(c, "*") == 0 ? 0 : strtoul(c, NULL, 10); // 0 if unknown
+    return true;
+}
+
+// Frees whatever ota_pipe_create() got before failing, or all of it
+static void ota_pipe_free(OtaPipe *p) {
+    for (int i = 0; i < 2; ++i) {
+        free(p->bufs[i]);
+    }
+    if (p->free_q != NULL) vQueueDelete(p->free_q);
+    if (p->full_q != NULL) vQueueDelete(p->full_q);
+    if (p->done   != NULL) vSemaphoreDelete(p->done);
+}
+
+static bool ota_pipe_create(OtaPipe *p) {
+    p->free_q = xQueueCreate(2, sizeof(uint8_t *));
+    p->full_q = xQueueCreate(2, sizeof(OtaBlock));
+    p->done   = xSemaphoreCreateBinary();
+    if (p->free_q == NULL || p->full_q == NULL || p->done == NULL) {
+        return false;
+    }
+    for (int i = 0; i < 2; ++i) {
+        p->bufs[i] = (uint8_t *) malloc(OTA_BLOCK_SIZE);
+        if (p->bufs[i] == NULL) {
+            return false;
+        }
+        xQueueSend(p->free_q, &p->bufs[i], 0);
+    }
+    return xTaskCreate(ota_writer_task, "Net: OTA writer task",
+                       OTA_TASK_STACK_SIZE, p, 1, NULL) == pdPASS;
+}
+
+static OtaStatus ota_fetch(OtaPipe *p,
+                           const char *server, uint16_t port, const char *resource,
+                           size_t *offset, size_t *total, bool *begun) {
+    NetClient  client;
+    HttpClient http(client, server, port);
+    http.setHttpResponseTimeout(OTA_READ_TIMEOUT);
+
+    http.beginRequest();
+    if (http.get(resource) != 0) {
+        DBG("OTA: failed to connect");
+        return OTA_ERR_LINK;
+    }
+    if (*offset > 0) {
+        char range[32];
+        snprintf(range, sizeof(range), "bytes=%u-", (unsigned) *offset);
+        http.sendHeader("Range", range);
+    }
+    http.endRequest();
+
+    int status = http.responseStatusCode();
+    if (status < 0) {
+        return OTA_ERR_LINK;
+    }
+    if (status != 200 && status != 206) {
+        DBG("OTA: unexpected status", status);
+        return OTA_ERR_HTTP;
+    }
+
+    String content_range;
+    while (http.headerAvailable()) {
+        if (http.readHeaderName().equalsIgnoreCase("Content-Range")) {
+            content_range = http.readHeaderValue();
+        }
+    }
+
+    long length = http.contentLength();
+    if (length == HttpClient::kNoContentLengthHeader) {
+        DBG("OTA: no content length, cannot resume");
+        return OTA_ERR_HTTP;
+    }
+
+    size_t skip = 0;
+    if (status == 200) {
+        // range ignored by the server; drop what the writer already has
+        skip   = *offset;
+        *total = length;
+    } else {
+        // make sure the server resumed where we asked, of the same image
+        size_t first, complete;
+        if (!ota_parse_range(content_range.c_str(), &first, &complete)) {
+            DBG("OTA: bad or missing Content-Range");
+            return OTA_ERR_HTTP;
+        }
+        if (first != *offset || (*total > 0 && complete > 0 && complete != *total)) {
+            DBG("OTA: Content-Range does not match", first, complete);
+            return OTA_ERR_HTTP;
+        }
+        *total = *offset + length;
+        if (complete > 0 && complete != *total) {
+            DBG("OTA: Content-Range does not match the content length");
+            return OTA_ERR_HTTP;
+        }
+    }
+
+    if (!*begun) {
+        if (!p->writer->begin(*total)) {
+            return OTA_ERR_WRITE;
+        }
+        *begun = true;
+    }
+
+    unsigned long last_data = millis();
+    uint8_t *buf = NULL;
+    size_t   n   = 0;
+    while (*offset + n < *total) {
+        if (p->failed) {
+            break;
+        }
+        if (buf == NULL) {
+            // blocks while both buffers are with the writer
+            xQueueReceive(p->free_q, &buf, portMAX_DELAY);
+            n = 0;
+        }
+
+        if (http.available() <= 0) {
+            if (!http.connected() || millis() - last_data >= OTA_READ_TIMEOUT) {
+                DBG("OTA: link dropped at", *offset + n);
+                break;
+            }
+            delay(1);
+            continue;
+        }
+
+        size_t want = min((size_t) OTA_BLOCK_SIZE - n, *total - *offset - n);
+        if (skip > 0) {
+            want = min(want, skip);
+        }
+        int r = http.read(buf + n, want);
+        if (r <= 0) {
+            continue;
+        }
+        last_data = millis();
+
+        if (skip > 0) {
+            skip -= r;
+            continue;
+        }
+
+        n += r;
+        if (n == OTA_BLOCK_SIZE) {
+            ota_send_block(p, buf, n, offset);
+            buf = NULL;
+            n   = 0;
+        }
+    }
+
+    if (buf != NULL) {
+        if (n > 0) {
+            ota_send_block(p, buf, n, offset);
+        } else {
+            xQueueSend(p->free_q, &buf, portMAX_DELAY);
+        }
+    }
+    http.stop();
+
+    if (p->failed) {
+        return OTA_ERR_WRITE;
+    }
+    return *offset >= *total ? OTA_OK : OTA_ERR_LINK;
+}
+
+OtaStatus ota_download(const char *server, const char *resource,
+                       OtaWriter *writer, const uint8_t *sha256,
+                       uint16_t port) {
+    unsigned long start = millis();
+    if (port == 0) {
+        port = Net.ssl_ca_cert != NULL ? 443 : 80;
+    }
+
+    OtaPipe p;
+    p.writer = writer;
+    if (!ota_pipe_create(&p)) {
+        DBG("OTA: ERROR: out of memory");
+        ota_pipe_free(&p);
+        return OTA_ERR_NOMEM;
+    }
+    mbedtls_sha256_init(&p.sha);
+    mbedtls_sha256_starts(&p.sha, 0);
+
+    size_t    offset = 0;
+    size_t    total  = 0;
+    bool      begun  = false;
+    OtaStatus status = OTA_ERR_LINK;
+    int       tries  = 0;
+    while (tries <= OTA_MAX_RESUMES) {
+        size_t prev = offset;
+        status = ota_fetch(&p, server, port, resource, &offset, &total, &begun);
+        if (status != OTA_ERR_LINK) {
+            break;
+        }
+        // only consecutive attempts without progress count
+        tries = offset > prev ? 0 : tries + 1;
+        Serial.printf("OTA: resuming at %u/%u\n\r", (unsigned) offset, (unsigned) total);
+        long wait = millis();
+        while (!Net.connected() && millis() - wait < OTA_READ_TIMEOUT) {
+            delay(1000);
+        }
+    }
+
+    OtaBlock end = { NULL, 0 };
+    xQueueSend(p.full_q, &end, portMAX_DELAY);
+    xSemaphoreTake(p.done, portMAX_DELAY);
+    if (status == OTA_OK && p.failed) {
+        status = OTA_ERR_WRITE;
+    }
+
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&p.sha, digest);
+    mbedtls_sha256_free(&p.sha);
+    if (status == OTA_OK && sha256 != NULL && memcmp(digest, sha256, sizeof(digest)) != 0) {
+        DBG("OTA: hash mismatch");
+        status = OTA_ERR_HASH;
+    }
+
+    if (begun && !writer->end(status == OTA_OK) && status == OTA_OK) {
+        status = OTA_ERR_WRITE;
+    }
+
+    ota_pipe_free(&p);
+
+    Serial.printf("OTA: status %d, %u bytes, took %lu millis\n\r",
+                  status, (unsigned) offset, millis() - start);
+    return status;
+}
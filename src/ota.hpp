@@ -0,0 +1,65 @@
+#ifndef NET_CLIENT_OTA_H_
+#define NET_CLIENT_OTA_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define OTA_BLOCK_SIZE        4096  // bytes; two of these are allocated
+#define OTA_MAX_RESUMES       10    // consecutive attempts without progress
+#define OTA_READ_TIMEOUT      10000 // ms without data before resuming
+#define OTA_TASK_STACK_SIZE   4096  // bytes
+
+typedef enum {
+    OTA_OK,
+    OTA_ERR_LINK,  // dropped; resumed with a Range request until OTA_MAX_RESUMES
+    OTA_ERR_HTTP,
+    OTA_ERR_WRITE,
+    OTA_ERR_HASH,
+    OTA_ERR_NOMEM  // buffers, queues or the writer task could not be created
+} OtaStatus;
+
+// Destination of the image. write() is called in order, one block at a time.
+class OtaWriter {
+public:
+    virtual ~OtaWriter() {}
+    virtual bool begin(size_t size) = 0;
+    virtual bool write(const uint8_t *buf, size_t size) = 0;
+    virtual bool end(bool ok) = 0;
+};
+
+#ifdef ESP32
+// Writes to the next OTA partition through the Update library
+class OtaUpdateWriter : public OtaWriter {
+public:
+    bool begin(size_t size);
+    bool write(const uint8_t *buf, size_t size);
+    bool end(bool ok);
+};
+#endif
+
+// Writes to a file; used on host builds and for SD cards
+class OtaFileWriter : public OtaWriter {
+public:
+    const char *path;
+    FILE       *file = NULL;
+
+    OtaFileWriter(const char *path) : path(path) {}
+    bool begin(size_t size);
+    bool write(const uint8_t *buf, size_t size);
+    bool end(bool ok);
+};
+
+/*
+  Streams `resource' from `server' into `writer' in OTA_BLOCK_SIZE blocks.
+  The network read of one block overlaps the write of the previous one.
+  On a link drop (or failover), the download continues from the last
+  written byte with an HTTP Range request. If `sha256' is given, the
+  image is hashed as it is written and checked at the end.
+  A port of 0 picks 443 or 80 depending on Net.ssl_ca_cert.
+*/
+OtaStatus ota_download(const char *server, const char *resource,
+                       OtaWriter *writer, const uint8_t *sha256=NULL,
+                       uint16_t port=0);
+
+#endif // NET_CLIENT_OTA_H_
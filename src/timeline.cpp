@@ -0,0 +1,122 @@
+#include <Arduino.h>
+
+#include "net.hpp"
+
+NetTimelineClass NetTimeline;
+
+static const char phase_codes[NET_PHASE_COUNT] = { 'S', 'I', 'N', 'G', 'W' };
+static const char link_codes[3]                = { '-', 'W', 'G' };
+
+NetBringupRecord *NetTimelineClass::open(NetConnection link) {
+    return this->active[link] ? &this->pending[link] : NULL;
+}
+
+// Attempts are kept aside per link until they end, then added to the ring
+void NetTimelineClass::begin_attempt(NetConnection link) {
+    this->pending[link]            = NetBringupRecord();
+    this->pending[link].link       = link;
+    this->pending[link].started_at = millis();
+    this->phase[link]  = -1;
+    this->active[link] = true;
+}
+
+bool NetTimelineClass::in_attempt(NetConnection link) {
+    return this->active[link];
+}
+
+void NetTimelineClass::phase_begin(NetConnection link, NetPhase phase) {
+    NetBringupRecord *r = this->open(link);
+    if (r == NULL) {
+        return;
+    }
+    NetPhaseRecord *p = &r->phases[phase];
+    p->ran   = true;
+    p->start = millis() - r->started_at;
+    this->phase[link] = phase;
+}
+
+// called once per loop iteration of the phase; all but the first are retries
+void NetTimelineClass::phase_try(NetConnection link) {
+    NetBringupRecord *r = this->open(link);
+    if (r == NULL || this->phase[link] < 0) {
+        return;
+    }
+    ++r->phases[this->phase[link]].tries;
+}
+
+void NetTimelineClass::phase_end(NetConnection link, bool ok) {
+    NetBringupRecord *r = this->open(link);
+    if (r == NULL || this->phase[link] < 0) {
+        return;
+    }
+    NetPhaseRecord *p = &r->phases[this->phase[link]];
+    p->end = millis() - r->started_at;
+    p->ok  = ok;
+    this->phase[link] = -1;
+}
+
+void NetTimelineClass::step_failed(NetConnection link, const char *step) {
+    NetBringupRecord *r = this->open(link);
+    if (r != NULL) {
+        r->failed_step = step;
+    }
+}
+
+void NetTimelineClass::end_attempt(NetConnection link, bool ok) {
+    NetBringupRecord *r = this->open(link);
+    if (r == NULL) {
+        return;
+    }
+    if (this->phase[link] >= 0) {
+        this->phase_end(link, ok);
+    }
+    r->total = millis() - r->started_at;
+    r->ok    = ok;
+    this->active[link] = false;
+
+    portENTER_CRITICAL(&this->lock);
+    this->records[this->head] = *r;
+    this->head = (this->head + 1) % NET_TIMELINE_SIZE;
+    if (this->count < NET_TIMELINE_SIZE) {
+        ++this->count;
+    }
+    portEXIT_CRITICAL(&this->lock);
+}
+
+int NetTimelineClass::size() {
+    return this->count;
+}
+
+const NetBringupRecord *NetTimelineClass::get(int i) {
+    if (i < 0 || i >= this->count) {
+        return NULL;
+    }
+    int oldest = (this->head - this->count + NET_TIMELINE_SIZE) % NET_TIMELINE_SIZE;
+    return &this->records[(oldest + i) % NET_TIMELINE_SIZE];
+}
+
+/*
+  One line per attempt, oldest first:
+    <link> <ok> <total ms> <failed step|-> [<phase><start>+<duration>x<tries>[!] ...]
+  e.g.  G 1 21840 waitForNetwork S0+8120x1 I8120+310x1 N8430+12900x3 G21330+510x1
+  where `!' marks a phase that did not complete.
+*/
+void NetTimelineClass::print(Print &out) {
+    for (int i = 0; i < this->size(); ++i) {
+        const NetBringupRecord *r = this->get(i);
+        out.printf("%c %c %u %s", link_codes[r->link],
+                   r->ok ? '1' : '0',
+                   (unsigned) r->total,
+                   r->failed_step != NULL ? r->failed_step : "-");
+        for (int p = 0; p < NET_PHASE_COUNT; ++p) {
+            const NetPhaseRecord *ph = &r->phases[p];
+            if (!ph->ran) {
+                continue;
+            }
+            unsigned duration = ph->end >= ph->start ? ph->end - ph->start : 0;
+            out.printf(" %c%u+%ux%u%s", phase_codes[p], (unsigned) ph->start,
+                       duration, (unsigned) ph->tries, ph->ok ? "" : "!");
+        }
+        out.print("\n\r");
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef NET_CLIENT_TIMELINE_H_
+#define NET_CLIENT_TIMELINE_H_
+
+// Included from net.hpp, after NetConnection is declared
+
+#define NET_TIMELINE_SIZE 8 // bring-up attempts kept
+
+typedef enum {
+    NET_PHASE_GSM_SETUP,
+    NET_PHASE_GSM_INIT,
+    NET_PHASE_GSM_NET_CONNECT,
+    NET_PHASE_GSM_GPRS_CONNECT,
+    NET_PHASE_WIFI_CONNECT,
+    NET_PHASE_COUNT
+} NetPhase;
+
+struct NetPhaseRecord {
+    uint32_t start   = 0; // ms since the attempt started
+    uint32_t end     = 0;
+    uint16_t tries   = 0; // loop iterations; retries are tries - 1
+    bool     ran     = false;
+    bool     ok      = false;
+};
+
+struct NetBringupRecord {
+    NetConnection  link        = NET_CON_NONE;
+    uint32_t       started_at  = 0;    // millis()
+    uint32_t       total       = 0;    // ms to online, or to giving up
+    bool           ok          = false;
+    const char    *failed_step = NULL; // last AT step that failed, even if retried fine
+    NetPhaseRecord phases[NET_PHASE_COUNT];
+};
+
+/*
+  Ring buffer of the last NET_TIMELINE_SIZE finished bring-up attempts of
+  both links, filled by gsm_start()/gsm_connect() and wifi_start().
+*/
+class NetTimelineClass {
+public:
+    void  begin_attempt(NetConnection link);
+    bool  in_attempt(NetConnection link);
+    void  phase_begin(NetConnection link, NetPhase phase);
+    void  phase_try(NetConnection link);
+    void  phase_end(NetConnection link, bool ok);
+    void  step_failed(NetConnection link, const char *step);
+    void  end_attempt(NetConnection link, bool ok);
+
+    int                     size();
+    const NetBringupRecord *get(int i); // 0 is the oldest finished attempt
+    void                    print(Print &out);
+
+private:
+    portMUX_TYPE     lock = portMUX_INITIALIZER_UNLOCKED;
+    NetBringupRecord records[NET_TIMELINE_SIZE];
+    int              head    = 0; // next slot to use
+    int              count   = 0;
+    NetBringupRecord pending[3];                  // attempt in progress per link
+    bool             active[3] = { false };
+    int              phase[3]  = { -1, -1, -1 };  // open phase per link
+
+    NetBringupRecord *open(NetConnection link);
+};
+
+extern NetTimelineClass NetTimeline;
+
+#endif // NET_CLIENT_TIMELINE_H_
@@ -11,8 +11,15 @@
 #define WIFI_CONNECTED() (WiFiMulti.run() == WL_CONNECTED)
 #endif
 
+// Failed silent (background) attempts leave the NetTimeline record open,
+// so the one that succeeds reports the whole time since the link was lost
 bool wifi_start(const char *ssid, const char *passwd,
                 int retry_timout=5000, bool silent=false) {
+    if (!NetTimeline.in_attempt(NET_CON_WIFI)) {
+        NetTimeline.begin_attempt(NET_CON_WIFI);
+        NetTimeline.phase_begin(NET_CON_WIFI, NET_PHASE_WIFI_CONNECT);
+    }
+
     if (!silent) {
         Serial.print("Attempting to connect to SSID: ");
         Serial.println(ssid);
@@ -23,12 +30,19 @@ bool wifi_start(const char *ssid, const char *passwd,
     WIFI_START(ssid, passwd);
     while (!WIFI_CONNECTED()) {
         if (millis() - start >= retry_timout) {
+            NetTimeline.step_failed(NET_CON_WIFI, "WiFi.begin");
+            if (!silent) {
+                NetTimeline.end_attempt(NET_CON_WIFI, false);
+            }
             return false;
         }
+        NetTimeline.phase_try(NET_CON_WIFI);
         if (!silent) Serial.print(".");
         delay(500);
     }
 
+    NetTimeline.end_attempt(NET_CON_WIFI, true);
+
     if (!silent) {
         Serial.print("Connected to ");
         Serial.println(ssid);